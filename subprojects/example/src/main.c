@@ -101,13 +101,17 @@ int main(void) {
     fclose(certf);
     free(errbuf);
 
-    // Initialize JSON-RPC handler
+    // Initialize JSON-RPC handler. Context must start zeroed, unset fields are defaults
     jsonrpc_ctx ctx = {0};
     ctx.handlers = handlers;
     ctx.response_transformer = add_signature;
     ctx.data = &sign_key;
+    ctx.trace_sample = 1; // Trace everything here, 100 would sample 1% of requests
     jsonrpc_ctx_init(&ctx);
 
+    // Handlers here have no side effects, so let them (and signing) warm up before first real request
+    jsonrpc_ctx_warmup(&ctx, WARMUP_ALL);
+
     const char *req0 = "{\"jsonrpc\":\"2.0\",\"id\":3.0,\"method\":\"version\",\"params\":[]}";
     const char *req1 = "{\"jsonrpc\":\"2.0\",\"id\":2.0,\"method\":\"version\"}";
     const char *req2 = "{\"jsonrpc\":\"2.0\",\"id\":1.0,\"method\":\"hello\"}";
@@ -129,6 +133,11 @@ int main(void) {
     (void) jsonrpc_handle_request_simple(&ctx, req7, strlen(req7), &response, 2048, &err); printf("%s\n", response);
     free(response);
 
+    // Convert with jsonrpc_trace_dump
+    if(jsonrpc_trace_save("jsonrpc.trace") < 0) {
+        perror("jsonrpc_trace_save");
+    }
+
     jsonrpc_ctx_destroy(&ctx);
 
     // Deinitialize OpenSSL
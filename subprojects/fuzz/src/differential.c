@@ -0,0 +1,216 @@
+/*
+ * This file is part of project jsonrpc_server, licensed under the MIT License (MIT).
+ *
+ * Copyright (c) 2019 Mark Vainomaa <mikroskeem@mikroskeem.eu>
+ * Copyright (c) Contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+// Differential run over generated and mutated request envelopes.
+// Usage: jsonrpc_differential [iterations] [seed] [snapshot path]
+// When snapshot path is given, paths run on dispatch table saved to it and mapped back by jsonrpc_ctx_init_snapshot
+
+#include "harness.h"
+#include "dispatch.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ENVELOPE_MAX (16 * 1024)
+
+#define ARRAY_LEN(a) (sizeof(a) / sizeof((a)[0]))
+
+// NULL means that member is left out
+static const char *versions[] = { NULL, "\"2.0\"", "\"2.0.1\"", "\"1.0\"", "\"\"", "2.0", "null" };
+static const char *ids[] = { NULL, "1", "-7", "2.5", "0.0", "\"abc\"", "null", "true", "[]", "{}" };
+static const char *methods[] = {
+    NULL, "\"echo\"", "\"hello\"", "\"invalid\"", "\"missing\"", "\"silent\"",
+    "\"nope\"", "\"hell\"", "\"hello \"", "\"\"", "5", "null", "[\"hello\"]"
+};
+static const char *params[] = {
+    NULL, "[]", "[1,\"a\"]", "{}", "{\"text\":\"hi\"}", "[[{}]]", "1", "\"x\"", "null", "true"
+};
+static const char *non_objects[] = { "1", "\"x\"", "null", "[]", "[1]", "{}" };
+static const char mutation_chars[] = "{}[],:\"0 \\";
+
+struct envelope {
+    char data[ENVELOPE_MAX];
+    size_t len;
+};
+
+static uint64_t rng_state;
+
+static uint64_t rng_next() {
+    // xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static size_t rng_below(size_t n) {
+    return (size_t) (rng_next() % n);
+}
+
+static void append(struct envelope *e, const char *str) {
+    size_t len = strlen(str);
+    if(e->len + len >= ENVELOPE_MAX)
+        return;
+
+    memcpy(e->data + e->len, str, len);
+    e->len += len;
+    e->data[e->len] = '\0';
+}
+
+static void append_member(struct envelope *e, int *first, const char *key, const char *value) {
+    if(value == NULL)
+        return;
+
+    if(!*first)
+        append(e, ",");
+    *first = 0;
+
+    append(e, "\"");
+    append(e, key);
+    append(e, "\":");
+    append(e, value);
+}
+
+static void generate_single(struct envelope *e) {
+    const char *members[4][2] = {
+        { "jsonrpc", versions[rng_below(ARRAY_LEN(versions))] },
+        { "id", ids[rng_below(ARRAY_LEN(ids))] },
+        { "method", methods[rng_below(ARRAY_LEN(methods))] },
+        { "params", params[rng_below(ARRAY_LEN(params))] },
+    };
+
+    // Mostly well-formed envelopes, otherwise validation rejects nearly everything
+    if(rng_below(4) != 0)
+        members[0][1] = "\"2.0\"";
+
+    // Member order must not matter
+    for(size_t i = ARRAY_LEN(members) - 1; i > 0; i--) {
+        size_t j = rng_below(i + 1);
+        const char *key = members[i][0];
+        const char *value = members[i][1];
+        members[i][0] = members[j][0];
+        members[i][1] = members[j][1];
+        members[j][0] = key;
+        members[j][1] = value;
+    }
+
+    int first = 1;
+    append(e, "{");
+    for(size_t i = 0; i < ARRAY_LEN(members); i++) {
+        append_member(e, &first, members[i][0], members[i][1]);
+    }
+    append(e, "}");
+}
+
+static void generate_batch(struct envelope *e) {
+    size_t count = rng_below(5);
+
+    append(e, "[");
+    for(size_t i = 0; i < count; i++) {
+        if(i > 0)
+            append(e, ",");
+
+        if(rng_below(8) == 0) {
+            append(e, non_objects[rng_below(ARRAY_LEN(non_objects))]);
+        } else {
+            generate_single(e);
+        }
+    }
+    append(e, "]");
+}
+
+static void mutate(struct envelope *e) {
+    size_t rounds = 1 + rng_below(4);
+    for(size_t i = 0; i < rounds && e->len > 0; i++) {
+        size_t pos = rng_below(e->len);
+        switch(rng_below(4)) {
+            case 0: // Replace
+                e->data[pos] = mutation_chars[rng_below(sizeof(mutation_chars) - 1)];
+                break;
+            case 1: // Delete
+                memmove(e->data + pos, e->data + pos + 1, e->len - pos);
+                e->len--;
+                break;
+            case 2: // Insert
+                if(e->len + 1 < ENVELOPE_MAX) {
+                    memmove(e->data + pos + 1, e->data + pos, e->len - pos + 1);
+                    e->data[pos] = mutation_chars[rng_below(sizeof(mutation_chars) - 1)];
+                    e->len++;
+                }
+                break;
+            case 3: // Truncate
+                e->len = pos;
+                e->data[pos] = '\0';
+                break;
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    unsigned long iterations = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+    rng_state = argc > 2 ? strtoull(argv[2], NULL, 10) : 1;
+    if(rng_state == 0)
+        rng_state = 1;
+
+    jsonrpc_ctx ctx = {0};
+    harness_ctx_init(&ctx);
+
+    if(argc > 3) {
+        if(jsonrpc_ctx_save_snapshot(&ctx, argv[3]) != 0) {
+            perror(argv[3]);
+            return 1;
+        }
+
+        jsonrpc_ctx_destroy(&ctx);
+        if(jsonrpc_ctx_init_snapshot(&ctx, argv[3]) != 0 || ctx.dispatch == NULL || !ctx.dispatch->mapped) {
+            fprintf(stderr, "%s: snapshot was not used\n", argv[3]);
+            return 1;
+        }
+    }
+
+    struct envelope *e = malloc(sizeof(struct envelope));
+    for(unsigned long i = 0; i < iterations; i++) {
+        e->len = 0;
+        e->data[0] = '\0';
+
+        if(rng_below(3) == 0) {
+            generate_batch(e);
+        } else {
+            generate_single(e);
+        }
+
+        if(rng_below(4) == 0)
+            mutate(e);
+
+        harness_check(&ctx, (const unsigned char *) e->data, e->len);
+    }
+    free(e);
+
+    jsonrpc_ctx_destroy(&ctx);
+
+    printf("%lu envelopes checked, all paths match reference\n", iterations);
+    return 0;
+}
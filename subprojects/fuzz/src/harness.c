@@ -0,0 +1,302 @@
+/*
+ * This file is part of project jsonrpc_server, licensed under the MIT License (MIT).
+ *
+ * Copyright (c) 2019 Mark Vainomaa <mikroskeem@mikroskeem.eu>
+ * Copyright (c) Contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "harness.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Size of serialized response buffer handed to request paths
+#define HARNESS_OUT_LEN (64 * 1024)
+
+// Helper macro
+#define harness_assert(cond) \
+    if(!(cond)) { \
+        fprintf(stderr, "harness: %s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        abort(); \
+    }
+
+static RPC_HANDLER(echo);
+static RPC_HANDLER(hello);
+static RPC_HANDLER(invalid);
+static RPC_HANDLER(missing);
+static RPC_HANDLER(silent);
+
+static json_t *add_method(jsonrpc_ctx *ctx, const char *method, json_t *original);
+static void count_span(const jsonrpc_ctx *ctx, int kind, uint32_t member, uint64_t start_ns, uint64_t duration_ns);
+static int simple_path(jsonrpc_ctx *ctx, const char *body, size_t body_len, char *out, size_t out_len);
+
+static const struct jsonrpc_handler handlers[] = {
+    RPC_ADD_HANDLER(echo),
+    RPC_ADD_HANDLER(hello),
+    RPC_ADD_HANDLER(invalid),
+    RPC_ADD_HANDLER(missing),
+    RPC_ADD_HANDLER(silent),
+    { "hello", echo },  // Duplicate, last one wins
+    RPC_HANDLERS_END
+};
+
+// Spans recorded during current path run, per kind
+static unsigned int span_counts[TRACE_USER];
+
+const struct harness_path harness_paths[] = {
+    { "simple", simple_path },
+    HARNESS_PATHS_END
+};
+
+void harness_ctx_init(jsonrpc_ctx *ctx) {
+    ctx->handlers = handlers;
+    ctx->response_transformer = add_method;
+    ctx->data = NULL;
+    ctx->trace_sample = 1;
+    ctx->trace_hook = count_span;
+    jsonrpc_ctx_init(ctx);
+}
+
+static json_int_t error_code(json_t *response) {
+    json_t *_error = json_object_get(response, "error");
+    harness_assert(json_is_object(_error));
+
+    json_t *_code = json_object_get(_error, "code");
+    harness_assert(json_is_integer(_code));
+
+    return json_integer_value(_code);
+}
+
+// Checks reference path result against JSON-RPC 2.0 rules it is expected to follow
+static void check_invariants(json_t *request, int r, json_t *response) {
+    if(json_is_array(request)) {
+        // Empty batch is an invalid request
+        if(json_array_size(request) < 1) {
+            harness_assert(r == ERR_INVALID);
+            harness_assert(error_code(response) == -32600);
+            return;
+        }
+
+        // Notifications never get a response, so there can't be more responses than members with id
+        size_t ind;
+        size_t with_id = 0;
+        json_t *child_request;
+        json_array_foreach(request, ind, child_request) {
+            if(json_object_get(child_request, "id") != NULL)
+                with_id++;
+        }
+
+        harness_assert(r == ERR_NONE);
+        harness_assert(json_is_array(response));
+        harness_assert(json_array_size(response) <= with_id);
+        return;
+    }
+
+    if(!json_is_object(request)) {
+        harness_assert(r == ERR_INVALID);
+        harness_assert(error_code(response) == -32600);
+        return;
+    }
+
+    switch(r) {
+        case ERR_NONE:
+            harness_assert(json_object_get(request, "id") != NULL);
+            harness_assert(json_object_get(response, "result") != NULL);
+            harness_assert(json_object_get(response, "error") == NULL);
+            break;
+        case ERR_NOMETHOD:
+            harness_assert(error_code(response) == -32601);
+            break;
+        case ERR_PARSE:
+        case ERR_INVALID:
+            harness_assert(error_code(response) == -32600);
+            break;
+        case ERR_NOTIF:
+            harness_assert(response == NULL);
+            break;
+        default:
+            harness_assert(!"unknown return code");
+    }
+}
+
+// Checks that sampled request recorded spans of every stage it went through
+static void check_spans(json_t *request, int r) {
+    harness_assert(span_counts[TRACE_REQUEST] == 1);
+    harness_assert(span_counts[TRACE_PARSE] == 1);
+    harness_assert(span_counts[TRACE_SERIALIZE] == 1);
+
+    if(request == NULL) {
+        harness_assert(span_counts[TRACE_VALIDATE] == 0);
+        return;
+    }
+
+    if(json_is_array(request)) {
+        harness_assert(span_counts[TRACE_MEMBER] == json_array_size(request));
+        harness_assert(json_array_size(request) < 1 || span_counts[TRACE_VALIDATE] >= 1);
+        return;
+    }
+
+    harness_assert(span_counts[TRACE_MEMBER] == 0);
+    harness_assert(span_counts[TRACE_VALIDATE] >= 1);
+    switch(r) {
+        case ERR_NONE:
+            harness_assert(span_counts[TRACE_VALIDATE] == 2);
+            harness_assert(span_counts[TRACE_DISPATCH] == 1);
+            harness_assert(span_counts[TRACE_HANDLER] == 1);
+            harness_assert(span_counts[TRACE_TRANSFORM] == 1);
+            break;
+        case ERR_NOMETHOD:
+            harness_assert(span_counts[TRACE_DISPATCH] == 1);
+            break;
+        case ERR_NOTIF:
+            harness_assert(span_counts[TRACE_DISPATCH] == 1);
+            harness_assert(span_counts[TRACE_HANDLER] == 1);
+            harness_assert(span_counts[TRACE_TRANSFORM] == 0);
+            break;
+    }
+}
+
+// Same shape as generate_invalid_json(), which is not exported
+static json_t *parse_error() {
+    json_t *error = json_object();
+    json_object_set_new(error, "code", json_integer(-32700));
+    json_object_set_new(error, "message", json_string("Parse error"));
+
+    json_t *response = json_object();
+    json_object_set_new(response, "jsonrpc", json_string("2.0"));
+    json_object_set_new(response, "error", error);
+    json_object_set_new(response, "id", json_null());
+    return response;
+}
+
+// Reference path: plain parse, jsonrpc_handle_request and nothing else
+static int reference_path(jsonrpc_ctx *ctx, const char *body, json_t **response) {
+    // Without dispatch table methods are looked up linearly
+    jsonrpc_ctx reference = *ctx;
+    reference.dispatch = NULL;
+    reference.trace_sample = 0;
+    reference.trace_hook = NULL;
+    ctx = &reference;
+
+    json_error_t err = {0};
+    json_t *request = json_loads(body, 0, &err);
+    if(request == NULL) {
+        *response = parse_error();
+        return -1;
+    }
+
+    int r = jsonrpc_handle_request(ctx, request, response);
+    check_invariants(request, r, *response);
+    json_decref(request);
+
+    return r;
+}
+
+void harness_check(jsonrpc_ctx *ctx, const unsigned char *data, size_t size) {
+    // Request paths expect NUL terminated body
+    char *body = malloc(size + 1);
+    memcpy(body, data, size);
+    body[size] = '\0';
+
+    json_t *expected = NULL;
+    int expected_r = reference_path(ctx, body, &expected);
+
+    // Reference path itself must not depend on previous requests
+    json_t *again = NULL;
+    int again_r = reference_path(ctx, body, &again);
+    harness_assert(expected_r == again_r);
+    harness_assert((expected == NULL) == (again == NULL));
+    harness_assert(expected == NULL || json_equal(expected, again));
+    json_decref(again);
+
+    char *expected_str = expected != NULL ? json_dumps(expected, 0) : NULL;
+    json_decref(expected);
+
+    json_error_t err = {0};
+    json_t *request = json_loads(body, 0, &err);
+
+    char *out = malloc(HARNESS_OUT_LEN);
+    for(const struct harness_path *p = harness_paths; p->name != NULL; p++) {
+        memset(out, 0, HARNESS_OUT_LEN);
+        memset(span_counts, 0, sizeof(span_counts));
+        int r = p->run(ctx, body, size, out, HARNESS_OUT_LEN);
+
+        const char *want = expected_str != NULL ? expected_str : "";
+        if(r != expected_r || strncmp(want, out, HARNESS_OUT_LEN - 1) != 0) {
+            fprintf(stderr, "harness: path '%s' diverged from reference\n", p->name);
+            fprintf(stderr, "  input:    %s\n", body);
+            fprintf(stderr, "  expected: (%d) %s\n", expected_r, want);
+            fprintf(stderr, "  got:      (%d) %s\n", r, out);
+            abort();
+        }
+
+        check_spans(request, r);
+    }
+
+    json_decref(request);
+    free(out);
+    free(expected_str);
+    free(body);
+}
+
+static int simple_path(jsonrpc_ctx *ctx, const char *body, size_t body_len, char *out, size_t out_len) {
+    json_error_t err = {0};
+    return jsonrpc_handle_request_simple(ctx, body, body_len, &out, out_len, &err);
+}
+
+static RPC_HANDLER(echo) {
+    IF_RPC_FLAG(FLAG_IS_NOTIF)
+        return ERR_NOTIF;
+
+    *response = parameters != NULL ? json_incref(parameters) : json_null();
+    return ERR_NONE;
+}
+
+static RPC_HANDLER(hello) {
+    IF_RPC_FLAG(FLAG_IS_NOTIF)
+        return ERR_NOTIF;
+
+    *response = json_string("world!");
+    return ERR_NONE;
+}
+
+static RPC_HANDLER(invalid) {
+    return ERR_INVALID;
+}
+
+static RPC_HANDLER(missing) {
+    return ERR_NOMETHOD;
+}
+
+static RPC_HANDLER(silent) {
+    return ERR_NOTIF;
+}
+
+static json_t *add_method(jsonrpc_ctx *ctx, const char *method, json_t *original) {
+    json_object_set_new(original, "method", json_string(method));
+    return original;
+}
+
+static void count_span(const jsonrpc_ctx *ctx, int kind, uint32_t member, uint64_t start_ns, uint64_t duration_ns) {
+    harness_assert(kind >= 0 && kind < TRACE_USER);
+    harness_assert(kind != TRACE_MEMBER || member != 0);
+    span_counts[kind]++;
+}
@@ -0,0 +1,52 @@
+/*
+ * This file is part of project jsonrpc_server, licensed under the MIT License (MIT).
+ *
+ * Copyright (c) 2019 Mark Vainomaa <mikroskeem@mikroskeem.eu>
+ * Copyright (c) Contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include "jsonrpc.h"
+
+/**
+ * Request path under test. Takes raw request body and writes serialized
+ * response into out (out_len bytes, always NUL terminated, empty on notification)
+ */
+struct harness_path {
+    const char *name;
+    int (*run)(jsonrpc_ctx *ctx, const char *body, size_t body_len, char *out, size_t out_len);
+};
+
+/**
+ * Convenience macro to end request paths list
+ */
+#define HARNESS_PATHS_END { NULL, NULL }
+
+// Paths which are checked against the reference path
+extern const struct harness_path harness_paths[];
+
+// Sets up context with harness handlers, response transformer, dispatch table and tracing
+void harness_ctx_init(jsonrpc_ctx *ctx);
+
+// Runs every path against reference path on given input, aborts on mismatch
+void harness_check(jsonrpc_ctx *ctx, const unsigned char *data, size_t size);
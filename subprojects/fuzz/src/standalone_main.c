@@ -0,0 +1,80 @@
+/*
+ * This file is part of project jsonrpc_server, licensed under the MIT License (MIT).
+ *
+ * Copyright (c) 2019 Mark Vainomaa <mikroskeem@mikroskeem.eu>
+ * Copyright (c) Contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+// Replays inputs through LLVMFuzzerTestOneInput without libFuzzer, used for AFL
+// and for reproducing crashes. Reads files given as arguments, or stdin.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+static int run_file(FILE *f) {
+    size_t len = 0;
+    size_t cap = 4096;
+    unsigned char *buf = malloc(cap);
+
+    size_t n;
+    while((n = fread(buf + len, 1, cap - len, f)) > 0) {
+        len += n;
+        if(len == cap) {
+            cap *= 2;
+            buf = realloc(buf, cap);
+        }
+    }
+
+    if(ferror(f)) {
+        free(buf);
+        return 1;
+    }
+
+    LLVMFuzzerTestOneInput(buf, len);
+    free(buf);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if(argc < 2) {
+        return run_file(stdin);
+    }
+
+    for(int i = 1; i < argc; i++) {
+        FILE *f = fopen(argv[i], "rb");
+        if(f == NULL) {
+            perror(argv[i]);
+            return 1;
+        }
+
+        int r = run_file(f);
+        fclose(f);
+        if(r != 0) {
+            fprintf(stderr, "Failed to read %s\n", argv[i]);
+            return r;
+        }
+    }
+
+    return 0;
+}
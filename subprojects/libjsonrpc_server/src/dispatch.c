@@ -0,0 +1,377 @@
+/*
+ * This file is part of project jsonrpc_server, licensed under the MIT License (MIT).
+ *
+ * Copyright (c) 2019 Mark Vainomaa <mikroskeem@mikroskeem.eu>
+ * Copyright (c) Contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "jsonrpc_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define table_entries(table) ((struct dispatch_entry *) ((char *) (table) + sizeof(struct dispatch_header)))
+#define table_name(table, entry) ((const char *) (table) + (entry)->name_offset)
+
+uint64_t dispatch_hash(const char *name, size_t len) {
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for(size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char) name[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+uint64_t dispatch_fingerprint(const struct jsonrpc_handler *handlers, size_t *count) {
+    // FNV-1a over names including NUL, so that ["ab", "c"] and ["a", "bc"] differ
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    size_t n = 0;
+    for(const struct jsonrpc_handler *h = handlers; h->name != NULL; h++, n++) {
+        const char *c = h->name;
+        do {
+            hash ^= (unsigned char) *c;
+            hash *= 0x100000001b3ULL;
+        } while(*c++ != '\0');
+    }
+
+    *count = n;
+    return hash;
+}
+
+static uint64_t checksum_update(uint64_t hash, const char *data, size_t len) {
+    // FNV-1a over 64-bit words, fast enough to verify whole snapshot on every load
+    size_t i = 0;
+    for(; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        hash ^= word;
+        hash *= 0x100000001b3ULL;
+    }
+    for(; i < len; i++) {
+        hash ^= (unsigned char) data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static uint64_t table_checksum(const struct dispatch_header *table) {
+    uint64_t hash = checksum_update(0xcbf29ce484222325ULL, (const char *) table, offsetof(struct dispatch_header, checksum));
+    return checksum_update(hash, (const char *) table + sizeof(struct dispatch_header),
+                           table->size - sizeof(struct dispatch_header));
+}
+
+static int key_compare(const struct dispatch_header *table, const struct dispatch_entry *entry,
+                       uint64_t hash, const char *name, size_t len) {
+    if(entry->hash != hash)
+        return entry->hash < hash ? -1 : 1;
+    if(entry->name_len != len)
+        return entry->name_len < len ? -1 : 1;
+    return memcmp(table_name(table, entry), name, len);
+}
+
+static int entry_compare(const struct dispatch_header *table, const struct dispatch_entry *a, const struct dispatch_entry *b) {
+    return key_compare(table, a, b->hash, table_name(table, b), b->name_len);
+}
+
+// Entry with its name, as qsort(3) has no way to pass table to comparator
+struct sort_entry {
+    struct dispatch_entry entry;
+    const char *name;
+};
+
+static int sort_entry_compare(const void *a, const void *b) {
+    const struct sort_entry *x = a;
+    const struct sort_entry *y = b;
+    if(x->entry.hash != y->entry.hash)
+        return x->entry.hash < y->entry.hash ? -1 : 1;
+    if(x->entry.name_len != y->entry.name_len)
+        return x->entry.name_len < y->entry.name_len ? -1 : 1;
+
+    int c = memcmp(x->name, y->name, x->entry.name_len);
+    if(c != 0)
+        return c;
+
+    // qsort(3) is not stable, keep duplicates in handlers list order
+    return x->entry.handler < y->entry.handler ? -1 : x->entry.handler > y->entry.handler;
+}
+
+struct dispatch_header *dispatch_build(const struct jsonrpc_handler *handlers) {
+    size_t count = 0;
+    size_t names_size = 0;
+    for(const struct jsonrpc_handler *h = handlers; h->name != NULL; h++) {
+        count++;
+        names_size += strlen(h->name) + 1;
+    }
+
+    size_t names_offset = sizeof(struct dispatch_header) + count * sizeof(struct dispatch_entry);
+    size_t size = names_offset + names_size;
+    if(size > UINT32_MAX)
+        return NULL;
+
+    struct dispatch_header *table = calloc(1, size);
+    struct sort_entry *sorted = malloc((count != 0 ? count : 1) * sizeof(struct sort_entry));
+    if(table == NULL || sorted == NULL) {
+        free(table);
+        free(sorted);
+        return NULL;
+    }
+
+    memcpy(table->magic, DISPATCH_MAGIC, sizeof(table->magic));
+    table->version = DISPATCH_VERSION;
+    table->size = size;
+    table->fingerprint = dispatch_fingerprint(handlers, &count);
+
+    char *names = (char *) table + names_offset;
+    for(size_t i = 0; i < count; i++) {
+        size_t len = strlen(handlers[i].name);
+        memcpy(names, handlers[i].name, len + 1);
+
+        sorted[i].entry = (struct dispatch_entry) {
+            .hash = dispatch_hash(names, len),
+            .name_offset = (uint32_t) (names - (char *) table),
+            .name_len = (uint32_t) len,
+            .handler = (uint32_t) i,
+        };
+        sorted[i].name = names;
+        names += len + 1;
+    }
+    qsort(sorted, count, sizeof(struct sort_entry), sort_entry_compare);
+
+    // Last handler wins on duplicate names, same as the linear lookup did
+    struct dispatch_entry *entries = table_entries(table);
+    size_t unique = 0;
+    for(size_t i = 0; i < count; i++) {
+        if(i + 1 < count && entry_compare(table, &sorted[i].entry, &sorted[i + 1].entry) == 0)
+            continue;
+        entries[unique++] = sorted[i].entry;
+    }
+    table->count = (uint32_t) unique;
+    table->checksum = table_checksum(table);
+
+    free(sorted);
+    return table;
+}
+
+const struct jsonrpc_handler *dispatch_find(const struct jsonrpc_handler *handlers, const struct dispatch_header *table,
+                                            const char *name, size_t len) {
+    const struct dispatch_entry *entries = table_entries(table);
+    uint64_t hash = dispatch_hash(name, len);
+
+    size_t lo = 0;
+    size_t hi = table->count;
+    while(lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int c = key_compare(table, &entries[mid], hash, name, len);
+        if(c == 0) {
+            return &handlers[entries[mid].handler];
+        } else if(c < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return NULL;
+}
+
+int dispatch_validate(const struct jsonrpc_handler *handlers, const struct dispatch_header *table, size_t size) {
+    // Header. Matching fingerprint means the table was built from the same list, so unlike
+    // dispatch_build this doesn't need to sort names
+    if(size < sizeof(struct dispatch_header))
+        return -1;
+    if(memcmp(table->magic, DISPATCH_MAGIC, sizeof(table->magic)) != 0 || table->version != DISPATCH_VERSION)
+        return -1;
+    if(table->size != size)
+        return -1;
+
+    // Catches corrupted and edited files, including ones which would pass the checks below,
+    // like lowered count or duplicate name pointing at earlier handler
+    if(table->checksum != table_checksum(table))
+        return -1;
+
+    size_t handlers_count;
+    if(table->fingerprint != dispatch_fingerprint(handlers, &handlers_count))
+        return -1;
+    if(table->count > handlers_count)
+        return -1;
+    if(table->count > (size - sizeof(struct dispatch_header)) / sizeof(struct dispatch_entry))
+        return -1;
+
+    // Rest keeps lookups in bounds even if checksum was forged: entries must point to
+    // handlers of the same name and be strictly ordered for binary search
+    const struct dispatch_entry *entries = table_entries(table);
+    size_t names_offset = sizeof(struct dispatch_header) + table->count * sizeof(struct dispatch_entry);
+    for(size_t i = 0; i < table->count; i++) {
+        const struct dispatch_entry *e = &entries[i];
+        if(e->handler >= handlers_count || e->name_offset < names_offset)
+            return -1;
+        if((size_t) e->name_offset + e->name_len >= size)
+            return -1;
+
+        const char *name = table_name(table, e);
+        const char *hname = handlers[e->handler].name;
+        if(name[e->name_len] != '\0' || strlen(hname) != e->name_len || memcmp(name, hname, e->name_len) != 0)
+            return -1;
+        if(e->hash != dispatch_hash(name, e->name_len))
+            return -1;
+        if(i > 0 && entry_compare(table, &entries[i - 1], e) >= 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+void dispatch_touch(const struct jsonrpc_dispatch_s *dispatch) {
+    // Fault in every page, matters mostly for mapped snapshots
+    long page_size = sysconf(_SC_PAGESIZE);
+    if(page_size <= 0)
+        page_size = 4096;
+
+    const volatile char *p = (const volatile char *) dispatch->table;
+    for(size_t off = 0; off < dispatch->table->size; off += (size_t) page_size) {
+        (void) p[off];
+    }
+}
+
+void dispatch_free(struct jsonrpc_dispatch_s *dispatch) {
+    if(dispatch->mapped) {
+        munmap(dispatch->table, dispatch->table->size);
+    } else {
+        free(dispatch->table);
+    }
+    free(dispatch);
+}
+
+JSONRPC_EXPORT
+int jsonrpc_ctx_save_snapshot(jsonrpc_ctx *ctx, const char *path) {
+    if(ctx->dispatch == NULL || ctx->dispatch->handlers != ctx->handlers)
+        return -1;
+
+    // Write to unique temporary file first, so that processes loading or saving the
+    // snapshot at the same time never see partial one
+    size_t tmp_len = strlen(path) + 8;
+    char *tmp_path = malloc(tmp_len);
+    if(tmp_path == NULL)
+        return -1;
+    snprintf(tmp_path, tmp_len, "%s.XXXXXX", path);
+
+    int fd = mkstemp(tmp_path);
+    if(fd < 0) {
+        free(tmp_path);
+        return -1;
+    }
+
+    // mkstemp(3) creates it with 0600
+    int r = fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+
+    const struct dispatch_header *table = ctx->dispatch->table;
+    const char *data = (const char *) table;
+    size_t left = table->size;
+    while(r == 0 && left > 0) {
+        ssize_t n = write(fd, data, left);
+        if(n < 0) {
+            r = -1;
+            break;
+        }
+        data += n;
+        left -= (size_t) n;
+    }
+
+    if(close(fd) != 0)
+        r = -1;
+    if(r == 0 && rename(tmp_path, path) != 0)
+        r = -1;
+    if(r != 0)
+        unlink(tmp_path);
+
+    free(tmp_path);
+    return r;
+}
+
+static struct jsonrpc_dispatch_s *map_snapshot(const struct jsonrpc_handler *handlers, const char *path) {
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return NULL;
+
+    struct stat st;
+    if(fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(struct dispatch_header)) {
+        close(fd);
+        return NULL;
+    }
+
+    size_t size = (size_t) st.st_size;
+    void *mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapped == MAP_FAILED)
+        return NULL;
+
+    // Snapshot of different handlers list or a corrupted one
+    if(dispatch_validate(handlers, mapped, size) != 0) {
+        munmap(mapped, size);
+        return NULL;
+    }
+
+    struct jsonrpc_dispatch_s *dispatch = malloc(sizeof(struct jsonrpc_dispatch_s));
+    if(dispatch == NULL) {
+        munmap(mapped, size);
+        return NULL;
+    }
+    dispatch->handlers = handlers;
+    dispatch->table = mapped;
+    dispatch->mapped = 1;
+
+    return dispatch;
+}
+
+JSONRPC_EXPORT
+int jsonrpc_ctx_init_snapshot(jsonrpc_ctx *ctx, const char *path) {
+    jsonrpc_ctx_destroy(ctx);
+    if(ctx->handlers == NULL)
+        return 0;
+
+    if((ctx->dispatch = map_snapshot(ctx->handlers, path)) != NULL)
+        return 0;
+
+    return jsonrpc_ctx_init(ctx);
+}
+
+JSONRPC_EXPORT
+int jsonrpc_ctx_load_snapshot(jsonrpc_ctx *ctx, const char *path) {
+    if(ctx->handlers == NULL)
+        return -1;
+
+    struct jsonrpc_dispatch_s *dispatch = map_snapshot(ctx->handlers, path);
+    if(dispatch == NULL)
+        return -1;
+
+    // Replace current table
+    if(ctx->dispatch != NULL)
+        dispatch_free(ctx->dispatch);
+    ctx->dispatch = dispatch;
+
+    return 0;
+}
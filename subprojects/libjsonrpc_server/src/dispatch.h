@@ -0,0 +1,83 @@
+/*
+ * This file is part of project jsonrpc_server, licensed under the MIT License (MIT).
+ *
+ * Copyright (c) 2019 Mark Vainomaa <mikroskeem@mikroskeem.eu>
+ * Copyright (c) Contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include "jsonrpc.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Method dispatch table. Stored as a single flat buffer so that it can be
+ * written to disk and mapped back as-is (native byte order):
+ *
+ *   struct dispatch_header
+ *   struct dispatch_entry[count]  sorted by (hash, name_len, name)
+ *   NUL terminated method names
+ */
+#define DISPATCH_MAGIC   "JRPCDSP"
+#define DISPATCH_VERSION (3)
+
+struct dispatch_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t count;
+    uint64_t size;          // Whole table size in bytes
+    uint64_t fingerprint;   // Of handlers list table was built from, see dispatch_fingerprint
+    uint64_t checksum;      // Of whole table except this field
+};
+
+struct dispatch_entry {
+    uint64_t hash;
+    uint32_t name_offset;   // Relative to table start
+    uint32_t name_len;
+    uint32_t handler;       // Index in ctx->handlers
+    uint32_t reserved;
+};
+
+struct jsonrpc_dispatch_s {
+    const struct jsonrpc_handler *handlers;  // List table was built for, see ctx->handlers
+    struct dispatch_header *table;
+    int mapped;             // Table is mmap(2)'d snapshot instead of malloc(3)'d
+};
+
+uint64_t dispatch_hash(const char *name, size_t len);
+
+// Hashes handler names in order, also counts them
+uint64_t dispatch_fingerprint(const struct jsonrpc_handler *handlers, size_t *count);
+
+// Builds dispatch table from handlers list. Returns NULL on allocation failure
+struct dispatch_header *dispatch_build(const struct jsonrpc_handler *handlers);
+
+// Checks that table of given size is well-formed and was built from handlers list
+int dispatch_validate(const struct jsonrpc_handler *handlers, const struct dispatch_header *table, size_t size);
+
+const struct jsonrpc_handler *dispatch_find(const struct jsonrpc_handler *handlers, const struct dispatch_header *table,
+                                            const char *name, size_t len);
+
+// Faults in every page of the table
+void dispatch_touch(const struct jsonrpc_dispatch_s *dispatch);
+
+void dispatch_free(struct jsonrpc_dispatch_s *dispatch);
@@ -25,18 +25,79 @@
 
 #include "jsonrpc_internal.h"
 
+static int handle_request(jsonrpc_ctx *ctx, json_t *request, json_t **response, int sampled);
+
 JSONRPC_EXPORT
 int jsonrpc_ctx_init(jsonrpc_ctx *ctx) {
+    // Calling it again rebuilds the table
+    jsonrpc_ctx_destroy(ctx);
+    if(ctx->handlers == NULL)
+        return 0;
+
+    struct jsonrpc_dispatch_s *dispatch = malloc(sizeof(struct jsonrpc_dispatch_s));
+    if(dispatch == NULL)
+        return -1;
+
+    dispatch->handlers = ctx->handlers;
+    dispatch->mapped = 0;
+    if((dispatch->table = dispatch_build(ctx->handlers)) == NULL) {
+        free(dispatch);
+        return -1;
+    }
+
+    ctx->dispatch = dispatch;
     return 0;
 }
 
 JSONRPC_EXPORT
 int jsonrpc_ctx_destroy(jsonrpc_ctx *ctx) {
+    if(ctx->dispatch != NULL) {
+        dispatch_free(ctx->dispatch);
+        ctx->dispatch = NULL;
+    }
     return 0;
 }
 
-int handle_request_single(jsonrpc_ctx *ctx, json_t *request, json_t **response) {
+JSONRPC_EXPORT
+int jsonrpc_ctx_warmup(jsonrpc_ctx *ctx, int flags) {
+    if(ctx->handlers == NULL)
+        return -1;
+
+    if((flags & WARMUP_DISPATCH) != 0) {
+        // Rebuild if handlers were replaced after jsonrpc_ctx_init
+        if(ctx->dispatch != NULL && ctx->dispatch->handlers != ctx->handlers)
+            jsonrpc_ctx_destroy(ctx);
+        if(ctx->dispatch == NULL && jsonrpc_ctx_init(ctx) != 0)
+            return -1;
+
+        dispatch_touch(ctx->dispatch);
+    }
+
+    if((flags & WARMUP_TRACE) != 0 && trace_warmup(ctx) != 0)
+        return -1;
+
+    if((flags & WARMUP_HANDLERS) != 0) {
+        for(const struct jsonrpc_handler *h = ctx->handlers; h->name != NULL; h++) {
+            json_t *request = json_object();
+            json_object_set_new(request, "jsonrpc", json_string("2.0"));
+            json_object_set_new(request, "id", json_null());
+            json_object_set_new(request, "method", json_string(h->name));
+
+            // Never sampled, so it does not show up in traces or count towards trace_sample
+            json_t *response = NULL;
+            (void) handle_request(ctx, request, &response, 0);
+            if(response != NULL)
+                json_decref(response);
+            json_decref(request);
+        }
+    }
+
+    return 0;
+}
+
+int handle_request_single(jsonrpc_ctx *ctx, json_t *request, json_t **response, int sampled) {
     int flags = 0;
+    uint64_t span = trace_span_begin(sampled);
 
     // Verify JSON-RPC version
     json_t *_version = json_object_get(request, "jsonrpc");
@@ -44,10 +105,12 @@ int handle_request_single(jsonrpc_ctx *ctx, json_t *request, json_t **response)
         const char *ver = json_string_value(_version);
         if(strncmp("2.0", ver, 3) != 0) {
             *response = generate_invalid_request(NULL);
+            trace_span_end(span, TRACE_VALIDATE);
             return ERR_INVALID;
         }
     } else {
         *response = generate_invalid_request(NULL);
+        trace_span_end(span, TRACE_VALIDATE);
         return ERR_INVALID;
     }
 
@@ -56,37 +119,49 @@ int handle_request_single(jsonrpc_ctx *ctx, json_t *request, json_t **response)
     if(_id != NULL) {
         if(!(json_is_string(_id) || json_is_integer(_id) || json_is_real(_id) || json_is_null(_id))) {
             *response = generate_invalid_request(NULL);
+            trace_span_end(span, TRACE_VALIDATE);
             return ERR_PARSE;
         }
     } else {
         // *sigh*
         flags |= FLAG_IS_NOTIF;
     }
+    trace_span_end(span, TRACE_VALIDATE);
 
     // Check if given JSON-RPC method exists
-    struct jsonrpc_handler *found_handler = NULL;
+    span = trace_span_begin(sampled);
+    const struct jsonrpc_handler *found_handler = NULL;
     json_t *_method = json_object_get(request, "method");
     const char *mname;
     if(json_is_string(_method)) {
         mname = json_string_value(_method);
         size_t len = strlen(mname);
 
-        for(struct jsonrpc_handler *h = (struct jsonrpc_handler *) ctx->handlers; h->name != NULL; h++) {
-            if(strlen(h->name) == len && strncmp(h->name, mname, len) == 0) {
-                found_handler = h;
+        // Table entries index into the list it was built for, handlers may have been replaced since
+        if(ctx->dispatch != NULL && ctx->dispatch->handlers == ctx->handlers) {
+            found_handler = dispatch_find(ctx->handlers, ctx->dispatch->table, mname, len);
+        } else {
+            for(const struct jsonrpc_handler *h = ctx->handlers; h->name != NULL; h++) {
+                if(strlen(h->name) == len && strncmp(h->name, mname, len) == 0) {
+                    found_handler = h;
+                }
             }
         }
 
         if(found_handler == NULL) {
             *response = generate_method_not_found(_id);
+            trace_span_end(span, TRACE_DISPATCH);
             return ERR_NOMETHOD;
         }
     } else {
         *response = generate_invalid_request(_id);
+        trace_span_end(span, TRACE_DISPATCH);
         return ERR_INVALID;
     }
+    trace_span_end(span, TRACE_DISPATCH);
 
     // Check params
+    span = trace_span_begin(sampled);
     json_t *_params = json_object_get(request, "params");
     if(_params != NULL) {
         if(json_is_array(_params)) {
@@ -95,13 +170,17 @@ int handle_request_single(jsonrpc_ctx *ctx, json_t *request, json_t **response)
             flags |= FLAG_KV_PARAMS;
         } else {
             *response = generate_invalid_request(_id);
+            trace_span_end(span, TRACE_VALIDATE);
             return ERR_INVALID;
         }
     }
+    trace_span_end(span, TRACE_VALIDATE);
 
     // Run handler
     json_t *_response = NULL;
+    span = trace_span_begin(sampled);
     int r = found_handler->handler(ctx, flags, _params, &_response);
+    trace_span_end(span, TRACE_HANDLER);
 
     switch(r) {
         case ERR_NONE:
@@ -131,14 +210,15 @@ int handle_request_single(jsonrpc_ctx *ctx, json_t *request, json_t **response)
 
     // Transform response if transformer function is set
     if(ctx->response_transformer != NULL) {
+        span = trace_span_begin(sampled);
         *response = ctx->response_transformer(ctx, mname, *response);
+        trace_span_end(span, TRACE_TRANSFORM);
     }
 
     return ERR_NONE;
 }
 
-JSONRPC_EXPORT
-int jsonrpc_handle_request(jsonrpc_ctx *ctx, json_t *request, json_t **response) {
+static int handle_request(jsonrpc_ctx *ctx, json_t *request, json_t **response, int sampled) {
     json_incref(request);
 
     if(json_is_array(request)) {
@@ -156,30 +236,48 @@ int jsonrpc_handle_request(jsonrpc_ctx *ctx, json_t *request, json_t **response)
         json_array_foreach(request, ind, child_request) {
             json_t *child_resp = NULL;
             json_incref(child_request);
-            int r = handle_request_single(ctx, child_request, &child_resp);
+
+            if(sampled)
+                trace_member((uint32_t) ind + 1);
+            uint64_t span = trace_span_begin(sampled);
+            int r = handle_request_single(ctx, child_request, &child_resp, sampled);
+            trace_span_end(span, TRACE_MEMBER);
 
             if(r == ERR_NOTIF) {
                 if(child_resp != NULL)
                     json_decref(child_resp);
             } else if(r > 0) {
                 // TODO: what did I have to do here again?
+                if(child_resp != NULL)
+                    json_decref(child_resp);
             } else {
                 json_array_append_new(*response, child_resp);
             }
             json_decref(child_request);
         }
+        if(sampled)
+            trace_member(0);
         json_decref(request);
         return ERR_NONE;
     } else if(json_is_object(request)) {
-        int r = handle_request_single(ctx, request, response);
+        int r = handle_request_single(ctx, request, response, sampled);
         json_decref(request);
         return r;
     } else {
         *response = generate_invalid_request(NULL);
+        json_decref(request);
         return ERR_INVALID;
     }
 }
 
+JSONRPC_EXPORT
+int jsonrpc_handle_request(jsonrpc_ctx *ctx, json_t *request, json_t **response) {
+    int sampled = trace_request_begin(ctx);
+    int r = handle_request(ctx, request, response, sampled);
+    trace_request_end(sampled);
+    return r;
+}
+
 JSONRPC_EXPORT
 int jsonrpc_handle_request_simple(jsonrpc_ctx *ctx,
                                   const char *json_body, size_t body_len,
@@ -192,20 +290,28 @@ int jsonrpc_handle_request_simple(jsonrpc_ctx *ctx,
         return r;
     }
 
+    int sampled = trace_request_begin(ctx);
+
+    uint64_t span = trace_span_begin(sampled);
     json_t *resp = NULL;
     json_t *base = json_loads(json_body, 0, err);
+    trace_span_end(span, TRACE_PARSE);
 
     if(base != NULL) {
-        r = jsonrpc_handle_request(ctx, base, &resp);
+        r = handle_request(ctx, base, &resp, sampled);
         json_decref(base);
     } else {
         // Parser error woo
-        base = generate_invalid_json();
+        resp = generate_invalid_json();
     }
 
-    // Serialize
-    char *serialized = json_dumps(resp, 0);
-    json_decref(resp);
+    // Serialize. Notifications produce no response at all
+    span = trace_span_begin(sampled);
+    char *serialized = NULL;
+    if(resp != NULL) {
+        serialized = json_dumps(resp, 0);
+        json_decref(resp);
+    }
 
     // If buffer is null, allocate one
     if(*response == NULL) {
@@ -213,8 +319,12 @@ int jsonrpc_handle_request_simple(jsonrpc_ctx *ctx,
     }
 
     // Copy
-    strncpy(*response, serialized, response_len - 1);
+    strncpy(*response, serialized != NULL ? serialized : "", response_len - 1);
+    (*response)[response_len - 1] = '\0';
     free(serialized);
+    trace_span_end(span, TRACE_SERIALIZE);
+
+    trace_request_end(sampled);
 
     return r;
 }
@@ -26,8 +26,10 @@
 #pragma once
 
 #include <jansson.h>
+#include <stdint.h>
 
 typedef struct jsonrpc_ctx_s jsonrpc_ctx;
+struct jsonrpc_dispatch_s;
 
 #define ERR_NONE      (0)
 #define ERR_NOMETHOD  (1)
@@ -39,6 +41,24 @@ typedef struct jsonrpc_ctx_s jsonrpc_ctx;
 #define FLAG_KV_PARAMS    (1 << 2)
 #define FLAG_IS_NOTIF     (1 << 3)  // In other words, "do not bother generating response"
 
+#define WARMUP_DISPATCH   (1)       // Build method dispatch table if needed and fault it in
+#define WARMUP_HANDLERS   (1 << 1)  // Run synthetic request through every handler and response transformer
+#define WARMUP_TRACE      (1 << 2)  // Allocate and fault in calling thread's trace ring, if tracing is enabled
+#define WARMUP_ALL        (WARMUP_DISPATCH | WARMUP_HANDLERS | WARMUP_TRACE)
+
+/**
+ * Trace span kinds
+ */
+#define TRACE_REQUEST     (0)       // Whole request, including batch members
+#define TRACE_PARSE       (1)
+#define TRACE_VALIDATE    (2)       // Version and id checks, then params check
+#define TRACE_DISPATCH    (3)       // Method lookup
+#define TRACE_HANDLER     (4)
+#define TRACE_TRANSFORM   (5)       // Response transformer
+#define TRACE_SERIALIZE   (6)
+#define TRACE_MEMBER      (7)       // Single batch member
+#define TRACE_USER        (64)      // First kind free for handlers' own spans
+
 /**
  * Convenience macros to create RPC method handlers
  */
@@ -64,6 +84,10 @@ struct jsonrpc_handler {
  */
 #define RPC_HANDLERS_END { NULL, NULL }
 
+/**
+ * Zero-initialize whole context (e.g. jsonrpc_ctx ctx = {0};) before setting any fields.
+ * Fields left unset are then defaults: no transformer, tracing off, no trace hook
+ */
 typedef struct jsonrpc_ctx_s {
     // JSON-RPC methods
     const struct jsonrpc_handler *handlers;
@@ -73,11 +97,61 @@ typedef struct jsonrpc_ctx_s {
 
     // Context data
     void *data;
+
+    // Tracing: sample every Nth request per thread into thread's trace ring, 0 disables.
+    // Each thread starts at a random offset, so first requests are not all sampled
+    unsigned int trace_sample;
+    unsigned int trace_ring_events; // Ring size, 0 for default
+
+    // Called for every span of sampled requests, before it is recorded into the ring.
+    // member is batch member index + 1, 0 when not in a batch
+    void (*trace_hook)(const jsonrpc_ctx *ctx, int kind, uint32_t member, uint64_t start_ns, uint64_t duration_ns);
+
+    // Derived state, managed by jsonrpc_ctx_init and jsonrpc_ctx_destroy. Replacing handlers
+    // afterwards falls back to slow lookup until jsonrpc_ctx_destroy and jsonrpc_ctx_init
+    struct jsonrpc_dispatch_s *dispatch;
 } jsonrpc_ctx;
 
+/**
+ * Must be called after setting handlers, before handling any requests. Only manages
+ * dispatch, rest of ctx must already be zero-initialized as above. Calling it again
+ * frees the old dispatch table and builds a new one
+ */
 int jsonrpc_ctx_init(jsonrpc_ctx *ctx);
 int jsonrpc_ctx_destroy(jsonrpc_ctx *ctx);
 
+/**
+ * Pays one-time costs up front instead of on first requests. WARMUP_HANDLERS
+ * calls handlers with no params and discards the results, so only use it
+ * when handlers have no side effects. WARMUP_TRACE only covers the calling
+ * thread, so every worker thread should call it before taking requests
+ */
+int jsonrpc_ctx_warmup(jsonrpc_ctx *ctx, int flags);
+
+/**
+ * Saves dispatch table to a file, which can be mmap(2)'d back by another process
+ * with the same handlers list. Loading fails if snapshot does not match ctx->handlers,
+ * in which case current table stays in use
+ */
+int jsonrpc_ctx_save_snapshot(jsonrpc_ctx *ctx, const char *path);
+int jsonrpc_ctx_load_snapshot(jsonrpc_ctx *ctx, const char *path);
+
+/**
+ * jsonrpc_ctx_init, but maps dispatch table from snapshot instead of building it.
+ * Falls back to building when snapshot is missing or does not match ctx->handlers
+ */
+int jsonrpc_ctx_init_snapshot(jsonrpc_ctx *ctx, const char *path);
+
+/**
+ * Span hooks, also usable from handlers. jsonrpc_trace_begin returns 0 when
+ * current request is not sampled, which jsonrpc_trace_end then ignores
+ */
+uint64_t jsonrpc_trace_begin(void);
+void jsonrpc_trace_end(uint64_t start, int kind);
+
+// Writes trace rings of all threads to a file, see trace_dump tool
+int jsonrpc_trace_save(const char *path);
+
 // Handles request
 int jsonrpc_handle_request(jsonrpc_ctx *ctx, json_t *json, json_t **response);
 
@@ -27,6 +27,8 @@
 
 #include "jsonrpc.h"
 #include "generic_errors.h"
+#include "dispatch.h"
+#include "trace.h"
 #include <string.h>
 
 #define JSONRPC_EXPORT __attribute__(( visibility("default") ))
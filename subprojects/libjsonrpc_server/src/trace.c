@@ -0,0 +1,307 @@
+/*
+ * This file is part of project jsonrpc_server, licensed under the MIT License (MIT).
+ *
+ * Copyright (c) 2019 Mark Vainomaa <mikroskeem@mikroskeem.eu>
+ * Copyright (c) Contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "jsonrpc_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+
+/**
+ * Every thread records into its own ring, so writers never contend. Rings are
+ * kept in a lock-free list for jsonrpc_trace_save. When a thread exits, its ring
+ * goes to a free list and is reused by the next thread which starts sampling, so
+ * there are never more rings than threads sampling at the same time.
+ */
+struct trace_ring {
+    struct trace_ring *next;
+    struct trace_ring *next_free;
+    uint64_t head;          // Next ring position, only written by owning thread
+    uint64_t mask;
+    struct trace_event events[];
+};
+
+struct trace_thread {
+    struct trace_ring *ring;
+    uint32_t thread;        // Order in which threads got their ring
+    unsigned int countdown; // Requests left until next sampled one, 0 before first request
+    int active;             // Currently in sampled request
+    const jsonrpc_ctx *ctx; // Of current sampled request
+    uint32_t request;
+    uint32_t member;
+    uint64_t start;
+};
+
+static struct trace_ring *rings = NULL;
+static uint32_t thread_count = 0;
+static _Thread_local struct trace_thread tls = {0};
+
+// Rings of exited threads. Only touched when threads start or stop sampling, so a lock is fine
+static struct trace_ring *free_rings = NULL;
+static pthread_mutex_t free_rings_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t ring_key;
+static int ring_key_ok = 0;
+
+uint64_t trace_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static struct trace_ring *ring_new(unsigned int events) {
+    // Round up to power of two
+    uint64_t capacity = 1;
+    while(capacity < (events != 0 ? events : TRACE_DEFAULT_RING_EVENTS))
+        capacity <<= 1;
+
+    struct trace_ring *ring = calloc(1, sizeof(struct trace_ring) + capacity * sizeof(struct trace_event));
+    if(ring == NULL)
+        return NULL;
+
+    ring->mask = capacity - 1;
+
+    // Publish
+    ring->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+    while(!__atomic_compare_exchange_n(&rings, &ring->next, ring, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    return ring;
+}
+
+// Thread exit destructor
+static void ring_retire(void *ring) {
+    pthread_mutex_lock(&free_rings_lock);
+    ((struct trace_ring *) ring)->next_free = free_rings;
+    free_rings = ring;
+    pthread_mutex_unlock(&free_rings_lock);
+}
+
+static void ring_key_init(void) {
+    ring_key_ok = pthread_key_create(&ring_key, ring_retire) == 0;
+}
+
+// Gets ring for calling thread, reusing one of an exited thread if possible
+static struct trace_ring *ring_acquire(unsigned int events) {
+    // Without destructor rings of exited threads would be lost
+    pthread_once(&ring_key_once, ring_key_init);
+    if(!ring_key_ok)
+        return NULL;
+
+    pthread_mutex_lock(&free_rings_lock);
+    struct trace_ring *ring = free_rings;
+    if(ring != NULL)
+        free_rings = ring->next_free;
+    pthread_mutex_unlock(&free_rings_lock);
+
+    if(ring == NULL && (ring = ring_new(events)) == NULL)
+        return NULL;
+
+    if(pthread_setspecific(ring_key, ring) != 0) {
+        ring_retire(ring);
+        return NULL;
+    }
+
+    tls.thread = __atomic_fetch_add(&thread_count, 1, __ATOMIC_RELAXED);
+    return ring;
+}
+
+static void record(int kind, uint64_t start, uint64_t end) {
+    if(tls.ctx->trace_hook != NULL)
+        tls.ctx->trace_hook(tls.ctx, kind, tls.member, start, end - start);
+
+    struct trace_ring *ring = tls.ring;
+    uint64_t pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    struct trace_event *e = &ring->events[pos & ring->mask];
+
+    // Invalidate slot first, readers skip it until seq matches again. Payload is
+    // written with relaxed atomics as jsonrpc_trace_save may be copying it right now
+    __atomic_store_n(&e->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    uint64_t duration = end - start;
+    __atomic_store_n(&e->start_ns, start, __ATOMIC_RELAXED);
+    __atomic_store_n(&e->duration_ns, duration > UINT32_MAX ? UINT32_MAX : (uint32_t) duration, __ATOMIC_RELAXED);
+    __atomic_store_n(&e->thread, tls.thread, __ATOMIC_RELAXED);
+    __atomic_store_n(&e->request, tls.request, __ATOMIC_RELAXED);
+    __atomic_store_n(&e->member, tls.member, __ATOMIC_RELAXED);
+    __atomic_store_n(&e->kind, (uint16_t) kind, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&e->seq, pos + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&ring->head, pos + 1, __ATOMIC_RELEASE);
+}
+
+// Random start in [1, sample], otherwise first request of every thread would be sampled
+static unsigned int countdown_start(unsigned int sample) {
+    uint64_t x = trace_now() ^ (uint64_t) (uintptr_t) &tls;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return (unsigned int) (x % sample) + 1;
+}
+
+int trace_request_sample(const jsonrpc_ctx *ctx) {
+    if(tls.active)
+        return 0;
+
+    if(tls.countdown == 0)
+        tls.countdown = countdown_start(ctx->trace_sample);
+    if(tls.countdown > 1) {
+        tls.countdown--;
+        return 0;
+    }
+    tls.countdown = ctx->trace_sample;
+
+    if(tls.ring == NULL && (tls.ring = ring_acquire(ctx->trace_ring_events)) == NULL)
+        return 0;
+
+    tls.active = 1;
+    tls.ctx = ctx;
+    tls.request++;
+    tls.member = 0;
+    tls.start = trace_now();
+    return 1;
+}
+
+int trace_warmup(const jsonrpc_ctx *ctx) {
+    if(ctx->trace_sample == 0)
+        return 0;
+
+    if(tls.ring == NULL && (tls.ring = ring_acquire(ctx->trace_ring_events)) == NULL)
+        return -1;
+
+    // Write to every page, reading would only map the shared zero page. Slot
+    // contents stay as they are, so concurrent jsonrpc_trace_save is fine
+    long page = sysconf(_SC_PAGESIZE);
+    uint64_t step = page > (long) sizeof(struct trace_event) ? (uint64_t) page / sizeof(struct trace_event) : 1;
+    for(uint64_t i = 0; i <= tls.ring->mask; i += step) {
+        __atomic_fetch_or(&tls.ring->events[i].seq, 0, __ATOMIC_RELAXED);
+    }
+    __atomic_fetch_or(&tls.ring->events[tls.ring->mask].seq, 0, __ATOMIC_RELAXED);
+    return 0;
+}
+
+void trace_request_finish(void) {
+    tls.member = 0;
+    record(TRACE_REQUEST, tls.start, trace_now());
+    tls.active = 0;
+}
+
+void trace_record(int kind, uint64_t start) {
+    record(kind, start, trace_now());
+}
+
+void trace_member(uint32_t member) {
+    tls.member = member;
+}
+
+JSONRPC_EXPORT
+uint64_t jsonrpc_trace_begin(void) {
+    if(!tls.active)
+        return 0;
+    return trace_now();
+}
+
+JSONRPC_EXPORT
+void jsonrpc_trace_end(uint64_t start, int kind) {
+    if(start == 0 || !tls.active)
+        return;
+    record(kind, start, trace_now());
+}
+
+// Copies events which are not being overwritten right now, oldest first
+static uint32_t ring_copy(const struct trace_ring *ring, struct trace_event *out) {
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint64_t capacity = ring->mask + 1;
+    uint64_t pos = head > capacity ? head - capacity : 0;
+
+    uint32_t count = 0;
+    for(; pos < head; pos++) {
+        const struct trace_event *e = &ring->events[pos & ring->mask];
+        if(__atomic_load_n(&e->seq, __ATOMIC_ACQUIRE) != pos + 1)
+            continue;
+
+        struct trace_event copy = {
+            .seq = pos + 1,
+            .start_ns = __atomic_load_n(&e->start_ns, __ATOMIC_RELAXED),
+            .duration_ns = __atomic_load_n(&e->duration_ns, __ATOMIC_RELAXED),
+            .thread = __atomic_load_n(&e->thread, __ATOMIC_RELAXED),
+            .request = __atomic_load_n(&e->request, __ATOMIC_RELAXED),
+            .member = __atomic_load_n(&e->member, __ATOMIC_RELAXED),
+            .kind = __atomic_load_n(&e->kind, __ATOMIC_RELAXED),
+        };
+
+        // Slot was overwritten while copying
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if(__atomic_load_n(&e->seq, __ATOMIC_RELAXED) != pos + 1)
+            continue;
+
+        out[count++] = copy;
+    }
+
+    return count;
+}
+
+JSONRPC_EXPORT
+int jsonrpc_trace_save(const char *path) {
+    FILE *f = fopen(path, "wb");
+    if(f == NULL)
+        return -1;
+
+    struct trace_ring *first = __atomic_load_n(&rings, __ATOMIC_ACQUIRE);
+
+    struct trace_file_header header = {0};
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    for(struct trace_ring *ring = first; ring != NULL; ring = ring->next) {
+        header.rings++;
+    }
+
+    int r = fwrite(&header, sizeof(header), 1, f) == 1 ? 0 : -1;
+    for(struct trace_ring *ring = first; ring != NULL && r == 0; ring = ring->next) {
+        struct trace_event *events = malloc((ring->mask + 1) * sizeof(struct trace_event));
+        if(events == NULL) {
+            r = -1;
+            break;
+        }
+
+        struct trace_file_ring file_ring = {
+            .count = ring_copy(ring, events),
+        };
+
+        if(fwrite(&file_ring, sizeof(file_ring), 1, f) != 1)
+            r = -1;
+        if(r == 0 && file_ring.count > 0 && fwrite(events, sizeof(struct trace_event), file_ring.count, f) != file_ring.count)
+            r = -1;
+        free(events);
+    }
+
+    if(fclose(f) != 0)
+        r = -1;
+    return r;
+}
@@ -0,0 +1,101 @@
+/*
+ * This file is part of project jsonrpc_server, licensed under the MIT License (MIT).
+ *
+ * Copyright (c) 2019 Mark Vainomaa <mikroskeem@mikroskeem.eu>
+ * Copyright (c) Contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include "jsonrpc.h"
+#include <stdint.h>
+
+/**
+ * Trace file written by jsonrpc_trace_save (native byte order):
+ *
+ *   struct trace_file_header
+ *   for each ring: struct trace_file_ring, struct trace_event[count] oldest first
+ *
+ * Rings are reused after their thread exits, so events carry the thread instead.
+ */
+#define TRACE_MAGIC   "JRPCTRC"
+#define TRACE_VERSION (2)
+
+#define TRACE_DEFAULT_RING_EVENTS (4096)
+
+struct trace_event {
+    uint64_t seq;           // Ring position + 1, written last. Used to detect torn reads
+    uint64_t start_ns;      // CLOCK_MONOTONIC
+    uint32_t duration_ns;   // Clamped to UINT32_MAX
+    uint32_t thread;        // Order in which threads started sampling
+    uint32_t request;       // Sampled request number within thread
+    uint32_t member;        // Batch member index + 1, 0 when not in a batch
+    uint16_t kind;          // TRACE_*
+    uint16_t reserved[3];
+};
+
+struct trace_file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t rings;
+};
+
+struct trace_file_ring {
+    uint32_t count;
+    uint32_t reserved;
+};
+
+uint64_t trace_now(void);
+
+// Records span from start until now into current sampled request
+void trace_record(int kind, uint64_t start);
+
+int trace_request_sample(const jsonrpc_ctx *ctx);
+void trace_request_finish(void);
+
+// Gets calling thread's ring and faults it in. No-op when tracing is off
+int trace_warmup(const jsonrpc_ctx *ctx);
+
+// Sets batch member which following spans belong to, 0 for none. Sampled requests only
+void trace_member(uint32_t member);
+
+/**
+ * Decides whether request starting now is sampled. Returns 1 if it is, pass the result
+ * to trace_request_end and span helpers. With tracing off this is a single check
+ */
+static inline int trace_request_begin(const jsonrpc_ctx *ctx) {
+    return ctx->trace_sample != 0 ? trace_request_sample(ctx) : 0;
+}
+
+static inline void trace_request_end(int sampled) {
+    if(sampled)
+        trace_request_finish();
+}
+
+// Library's own spans, no calls unless request is sampled
+static inline uint64_t trace_span_begin(int sampled) {
+    return sampled ? trace_now() : 0;
+}
+
+static inline void trace_span_end(uint64_t span, int kind) {
+    if(span != 0)
+        trace_record(kind, span);
+}
@@ -0,0 +1,172 @@
+/*
+ * This file is part of project jsonrpc_server, licensed under the MIT License (MIT).
+ *
+ * Copyright (c) 2019 Mark Vainomaa <mikroskeem@mikroskeem.eu>
+ * Copyright (c) Contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+// Converts trace file written by jsonrpc_trace_save into Chrome trace event JSON,
+// which both chrome://tracing and Perfetto UI can open.
+// Usage: jsonrpc_trace_dump <trace file> [output file]
+
+#include "trace.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char *kind_names[] = {
+    [TRACE_REQUEST] = "request",
+    [TRACE_PARSE] = "parse",
+    [TRACE_VALIDATE] = "validate",
+    [TRACE_DISPATCH] = "dispatch",
+    [TRACE_HANDLER] = "handler",
+    [TRACE_TRANSFORM] = "transform",
+    [TRACE_SERIALIZE] = "serialize",
+    [TRACE_MEMBER] = "batch member",
+};
+
+static json_t *span_name(uint16_t kind) {
+    if(kind < sizeof(kind_names) / sizeof(kind_names[0]) && kind_names[kind] != NULL)
+        return json_string(kind_names[kind]);
+
+    char name[32];
+    if(kind >= TRACE_USER) {
+        snprintf(name, sizeof(name), "user %u", kind - TRACE_USER);
+    } else {
+        snprintf(name, sizeof(name), "unknown %u", kind);
+    }
+    return json_string(name);
+}
+
+static json_t *thread_name(uint32_t thread) {
+    char name[32];
+    snprintf(name, sizeof(name), "thread %u", thread);
+
+    json_t *args = json_object();
+    json_object_set_new(args, "name", json_string(name));
+
+    json_t *event = json_object();
+    json_object_set_new(event, "name", json_string("thread_name"));
+    json_object_set_new(event, "ph", json_string("M"));
+    json_object_set_new(event, "pid", json_integer(1));
+    json_object_set_new(event, "tid", json_integer(thread));
+    json_object_set_new(event, "args", args);
+    return event;
+}
+
+static json_t *span(const struct trace_event *e) {
+    json_t *args = json_object();
+    json_object_set_new(args, "request", json_integer(e->request));
+    if(e->member != 0)
+        json_object_set_new(args, "member", json_integer(e->member - 1));
+
+    json_t *event = json_object();
+    json_object_set_new(event, "name", span_name(e->kind));
+    json_object_set_new(event, "cat", json_string("jsonrpc"));
+    json_object_set_new(event, "ph", json_string("X"));
+    json_object_set_new(event, "ts", json_real((double) e->start_ns / 1000.0));
+    json_object_set_new(event, "dur", json_real((double) e->duration_ns / 1000.0));
+    json_object_set_new(event, "pid", json_integer(1));
+    json_object_set_new(event, "tid", json_integer(e->thread));
+    json_object_set_new(event, "args", args);
+    return event;
+}
+
+static int read_trace(FILE *f, json_t *events) {
+    // Names every thread once, even when its events are spread over reused rings
+    json_t *named = json_object();
+    int r = 0;
+
+    struct trace_file_header header;
+    if(fread(&header, sizeof(header), 1, f) != 1
+            || memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0
+            || header.version != TRACE_VERSION) {
+        json_decref(named);
+        return -1;
+    }
+
+    for(uint32_t i = 0; i < header.rings && r == 0; i++) {
+        struct trace_file_ring ring;
+        if(fread(&ring, sizeof(ring), 1, f) != 1) {
+            r = -1;
+            break;
+        }
+
+        for(uint32_t j = 0; j < ring.count; j++) {
+            struct trace_event e;
+            if(fread(&e, sizeof(e), 1, f) != 1) {
+                r = -1;
+                break;
+            }
+
+            char key[16];
+            snprintf(key, sizeof(key), "%u", e.thread);
+            if(json_object_get(named, key) == NULL) {
+                json_object_set_new(named, key, json_true());
+                json_array_append_new(events, thread_name(e.thread));
+            }
+            json_array_append_new(events, span(&e));
+        }
+    }
+
+    json_decref(named);
+    return r;
+}
+
+int main(int argc, char **argv) {
+    if(argc < 2) {
+        fprintf(stderr, "Usage: %s <trace file> [output file]\n", argv[0]);
+        return 1;
+    }
+
+    FILE *in = fopen(argv[1], "rb");
+    if(in == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    json_t *events = json_array();
+    int r = read_trace(in, events);
+    fclose(in);
+    if(r != 0) {
+        fprintf(stderr, "%s: not a trace file or truncated\n", argv[1]);
+        json_decref(events);
+        return 1;
+    }
+
+    json_t *root = json_object();
+    json_object_set_new(root, "traceEvents", events);
+    json_object_set_new(root, "displayTimeUnit", json_string("ns"));
+
+    FILE *out = argc > 2 ? fopen(argv[2], "w") : stdout;
+    if(out == NULL) {
+        perror(argv[2]);
+        json_decref(root);
+        return 1;
+    }
+
+    r = json_dumpf(root, out, JSON_COMPACT);
+    fputc('\n', out);
+    if(out != stdout)
+        fclose(out);
+
+    json_decref(root);
+    return r == 0 ? 0 : 1;
+}